@@ -0,0 +1,410 @@
+// vim: tags+=~/Documents/DHI/PEGTL/taopeg.tags
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <climits>
+#include <string_view>
+#include <system_error>
+
+#include <evaluation.hpp>
+#include <grammar.hpp>
+
+using calc_stack = evaluation::stack;
+using calc_value = evaluation::value;
+using calc_status = evaluation::status;
+
+template<typename T> T promote(const calc_value& x)
+{
+    switch ( x.type )
+    {
+        case calc_value::kind::boolean:
+            return static_cast<T>(x.b);
+        case calc_value::kind::integer:
+            return static_cast<T>(x.i);
+        case calc_value::kind::floating:
+            return static_cast<T>(x.f);
+        default:
+            return T{};
+    }
+}
+
+// kinds are ordered by priority, opaque values cannot be promoted
+inline calc_value::kind promotion_type(const calc_value& a, const calc_value& b)
+{
+    return std::max(a.type, b.type);
+}
+
+inline std::errc parse_number(std::string_view text, long long& res, int base)
+{
+    return std::from_chars(text.data(), text.data() + text.size(), res, base).ec;
+}
+
+// stops on the fixed point suffix
+inline std::errc parse_number(std::string_view text, long double& res, int /*base*/)
+{
+    return std::from_chars(text.data(), text.data() + text.size(), res).ec;
+}
+
+// integer operation, checks the preconditions and overflows
+inline calc_status int_operation(char operation, long long l, long long r, long long& res)
+{
+    switch ( operation )
+    {
+        case '/':
+        case '%':
+            if ( r == 0 )
+            {
+                return calc_status::division_by_zero;
+            }
+            if ( l == LLONG_MIN && r == -1 )
+            {
+                return calc_status::out_of_range;
+            }
+            res = operation == '/' ? l / r : l % r;
+            return calc_status::ok;
+        case '<':
+        case '>':
+            if ( r < 0 || r >= static_cast<long long>(sizeof(long long) * CHAR_BIT) )
+            {
+                return calc_status::bad_operands;
+            }
+            if ( operation == '>' )
+            {
+                res = l >> r;
+                return calc_status::ok;
+            }
+            // negative or overflowing left shifts are undefined
+            if ( l < 0 || l > (LLONG_MAX >> r) )
+            {
+                return calc_status::out_of_range;
+            }
+            res = l << r;
+            return calc_status::ok;
+        case '+':
+            if ( (r > 0 && l > LLONG_MAX - r) || (r < 0 && l < LLONG_MIN - r) )
+            {
+                return calc_status::out_of_range;
+            }
+            res = l + r;
+            return calc_status::ok;
+        case '-':
+            if ( (r < 0 && l > LLONG_MAX + r) || (r > 0 && l < LLONG_MIN + r) )
+            {
+                return calc_status::out_of_range;
+            }
+            res = l - r;
+            return calc_status::ok;
+        case '*':
+            if ( l > 0 ? (r > 0 ? l > LLONG_MAX / r : r < LLONG_MIN / l)
+                       : (r > 0 ? l < LLONG_MIN / r : l != 0 && r < LLONG_MAX / l) )
+            {
+                return calc_status::out_of_range;
+            }
+            res = l * r;
+            return calc_status::ok;
+        case '|':
+            res = l | r;
+            return calc_status::ok;
+        case '^':
+            res = l ^ r;
+            return calc_status::ok;
+        case '&':
+            res = l & r;
+            return calc_status::ok;
+        default:
+            return calc_status::bad_operands;
+    }
+}
+
+// the failure is reported at the operator or operand, past the padding
+template<typename Input>
+void calc_fail(calc_stack& s, calc_status e, const Input& in)
+{
+    std::string_view text = in.string_view();
+    std::size_t padding = std::min(text.find_first_not_of(" \t\r\n\v\f"), text.size());
+    s.fail(e, in.position().byte + padding);
+}
+
+// Actions
+// Evaluate the expression over the calc_stack. Every specialization exposes an id
+// that tags the operation evaluated (used to check the evaluation order).
+// The first failure is kept on the stack and the remaining actions are skipped.
+template<typename Rule>
+struct calc_action : pegtl::nothing<Rule> {};
+
+#define load_action(Rule, name, T, prefix, base) \
+template<> \
+struct calc_action<Rule> \
+{ \
+    static constexpr const char* id = #name; \
+ \
+    template<typename Input> \
+    static void apply(const Input& in, calc_stack& s) \
+    { \
+        if ( !s.ok() ) return; \
+ \
+        T res; \
+        if ( parse_number(in.string_view().substr(prefix), res, base) != std::errc{} ) \
+        { \
+            calc_fail(s, calc_status::out_of_range, in); \
+            return; \
+        } \
+ \
+        s.push(evaluation::make_value(res)); \
+    } \
+};
+
+template<>
+struct calc_action<boolean_literal>
+{
+    static constexpr const char* id = "bool";
+
+    template<typename Input>
+    static void apply(const Input& in, calc_stack& s)
+    {
+        if ( !s.ok() ) return;
+
+        s.push(evaluation::make_value(in.string_view() == "TRUE"));
+    }
+};
+
+load_action(dec_literal, decimal, long long, 0, 10)
+load_action(oct_literal, octal, long long, 0, 8)
+load_action(hex_literal, hexa, long long, 2, 16)
+load_action(float_literal, float, long double, 0, 10)
+load_action(fixed_pt_literal, fixed, long double, 0, 10)
+
+template<>
+struct calc_action<scoped_name>
+{
+    static constexpr const char* id = "identifier";
+
+    template<typename Input>
+    static void apply(const Input& in, calc_stack& s)
+    {
+        // the calculator knows no identifiers
+        calc_fail(s, calc_status::unknown_identifier, in);
+    }
+};
+
+// binary operations: pop the right operand, the left one is replaced with the result
+template<typename Input>
+bool take_operands(calc_stack& s, const Input& in, calc_value*& l, calc_value& r)
+{
+    if ( !s.ok() )
+    {
+        return false;
+    }
+
+    if ( s.size() < 2 )
+    {
+        calc_fail(s, calc_status::bad_operands, in);
+        return false;
+    }
+
+    r = s.pop();
+    l = &s.top();
+    return true;
+}
+
+// unary operations: the operand is replaced with the result
+template<typename Input>
+bool take_operand(calc_stack& s, const Input& in, calc_value*& v)
+{
+    if ( !s.ok() )
+    {
+        return false;
+    }
+
+    if ( s.size() < 1 )
+    {
+        calc_fail(s, calc_status::bad_operands, in);
+        return false;
+    }
+
+    v = &s.top();
+    return true;
+}
+
+template<typename Input>
+void int_result(calc_stack& s, const Input& in, char operation, calc_value& l, const calc_value& r)
+{
+    long long res;
+    calc_status e = int_operation(operation, promote<long long>(l), promote<long long>(r), res);
+
+    if ( e != calc_status::ok )
+    {
+        calc_fail(s, e, in);
+        return;
+    }
+
+    l = evaluation::make_value(res);
+}
+
+#define float_op_action(Rule, name, operation) \
+template<> \
+struct calc_action<Rule> \
+{ \
+    static constexpr const char* id = #name; \
+ \
+    template<typename Input> \
+    static void apply(const Input& in, calc_stack& s) \
+    { \
+        calc_value* l; \
+        calc_value r; \
+        if ( !take_operands(s, in, l, r) ) return; \
+ \
+        const auto pt = promotion_type(*l, r); \
+ \
+        if ( calc_value::kind::integer == pt ) \
+        { \
+            int_result(s, in, #operation[0], *l, r); \
+        } \
+        else if ( calc_value::kind::floating == pt ) \
+        { \
+            *l = evaluation::make_value(static_cast<long double>( \
+                    promote<long double>(*l) operation promote<long double>(r))); \
+        } \
+        else \
+        { \
+            calc_fail(s, calc_status::bad_operands, in); \
+        } \
+    } \
+};
+
+#define int_op_action(Rule, name, operation) \
+template<> \
+struct calc_action<Rule> \
+{ \
+    static constexpr const char* id = #name; \
+ \
+    template<typename Input> \
+    static void apply(const Input& in, calc_stack& s) \
+    { \
+        calc_value* l; \
+        calc_value r; \
+        if ( !take_operands(s, in, l, r) ) return; \
+ \
+        const auto pt = promotion_type(*l, r); \
+ \
+        if ( calc_value::kind::integer == pt ) \
+        { \
+            int_result(s, in, #operation[0], *l, r); \
+        } \
+        else \
+        { \
+            calc_fail(s, calc_status::bad_operands, in); \
+        } \
+    } \
+};
+
+#define bool_op_action(Rule, name, operation) \
+template<> \
+struct calc_action<Rule> \
+{ \
+    static constexpr const char* id = #name; \
+ \
+    template<typename Input> \
+    static void apply(const Input& in, calc_stack& s) \
+    { \
+        calc_value* l; \
+        calc_value r; \
+        if ( !take_operands(s, in, l, r) ) return; \
+ \
+        const auto pt = promotion_type(*l, r); \
+ \
+        if ( calc_value::kind::integer == pt ) \
+        { \
+            int_result(s, in, #operation[0], *l, r); \
+        } \
+        else if ( calc_value::kind::boolean == pt ) \
+        { \
+            *l = evaluation::make_value(static_cast<bool>(promote<bool>(*l) operation promote<bool>(r))); \
+        } \
+        else \
+        { \
+            calc_fail(s, calc_status::bad_operands, in); \
+        } \
+    } \
+};
+
+bool_op_action(or_exec, or, |)
+bool_op_action(xor_exec, xor, ^)
+bool_op_action(and_exec, and, &)
+int_op_action(rshift_exec, >>, >>)
+int_op_action(lshift_exec, <<, <<)
+int_op_action(mod_exec, mod, %)
+float_op_action(add_exec, add, +)
+float_op_action(sub_exec, sub, -)
+float_op_action(mult_exec, mult, *)
+float_op_action(div_exec, div, /)
+
+template<>
+struct calc_action<minus_exec>
+{
+    static constexpr const char* id = "minus";
+
+    template<typename Input>
+    static void apply(const Input& in, calc_stack& s)
+    {
+        calc_value* v;
+        if ( !take_operand(s, in, v) ) return;
+
+        if ( calc_value::kind::integer == v->type )
+        {
+            if ( v->i == LLONG_MIN )
+            {
+                calc_fail(s, calc_status::out_of_range, in);
+                return;
+            }
+            *v = evaluation::make_value(-promote<long long>(*v));
+        }
+        else if ( calc_value::kind::floating == v->type )
+        {
+            *v = evaluation::make_value(-promote<long double>(*v));
+        }
+        else
+        {
+            calc_fail(s, calc_status::bad_operands, in);
+        }
+    }
+};
+
+template<>
+struct calc_action<plus_exec>
+{
+    static constexpr const char* id = "plus";
+
+    template<typename Input>
+    static void apply(const Input&, calc_stack&)
+    {
+        // noop
+    }
+};
+
+template<>
+struct calc_action<inv_exec>
+{
+    static constexpr const char* id = "inv";
+
+    template<typename Input>
+    static void apply(const Input& in, calc_stack& s)
+    {
+        calc_value* v;
+        if ( !take_operand(s, in, v) ) return;
+
+        if ( calc_value::kind::integer == v->type )
+        {
+            *v = evaluation::make_value(~promote<long long>(*v));
+        }
+        else if ( calc_value::kind::boolean == v->type )
+        {
+            *v = evaluation::make_value(!promote<bool>(*v));
+        }
+        else
+        {
+            calc_fail(s, calc_status::bad_operands, in);
+        }
+    }
+};
@@ -0,0 +1,517 @@
+// vim: tags+=~/Documents/DHI/PEGTL/taopeg.tags
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifdef _WIN32
+#   ifndef NOMINMAX
+#       define NOMINMAX
+#   endif
+#   include <windows.h>
+#else
+#   include <fcntl.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <unistd.h>
+#endif
+
+/* precompiled constants database */
+
+// File layout (native byte order, every section 8 bytes aligned):
+// + header
+// + seeds: an int32 per perfect hash bucket. Displacement seed of the bucket keys or,
+//   if negative, the slot (-slot - 1) of the bucket single key.
+// + entries: a constant per slot.
+// + pool: names and payloads (strings, fixed point digits, big integer magnitudes).
+
+namespace constdb {
+
+enum class kind : std::uint8_t
+{
+    boolean,
+    integer,
+    floating,
+    fixed,          // payload: decimal digits (maybe signed), scale: fractional digits
+    big_integer,    // payload: little endian magnitude, scale: 1 if negative
+    string,         // payload: utf8 string
+    character,      // payload: utf8 character
+    unsigned_integer // value: the unsigned bits
+};
+
+struct header
+{
+    char          magic[8];
+    std::uint32_t version;
+    std::uint32_t count;        // constants (and slots)
+    std::uint64_t source_hash;  // hash of the idl source the database was built from
+    std::uint32_t buckets;
+    std::uint32_t seeds;        // file offset
+    std::uint32_t entries;      // file offset
+    std::uint32_t pool;         // file offset
+    std::uint32_t pool_size;
+    std::uint32_t reserved;
+};
+
+struct entry
+{
+    std::uint32_t name;         // pool offset
+    std::uint32_t name_size;
+    std::uint32_t size;         // payload size
+    kind          type;
+    std::uint8_t  scale;
+    std::uint16_t reserved;
+    std::int64_t  value;        // boolean, integer, double bits or payload pool offset
+};
+
+static_assert(sizeof(header) == 48, "unexpected header padding");
+static_assert(sizeof(entry) == 24, "unexpected entry padding");
+
+constexpr char magic[8] = {'I', 'D', 'L', 'C', 'D', 'B', '\0', '\1'};
+constexpr std::uint32_t version = 2;
+
+// FNV-1a with a final mix so that every seed spreads the keys differently
+inline std::uint64_t hash(std::string_view data, std::uint64_t seed = 0)
+{
+    std::uint64_t h = 14695981039346656037ull ^ (seed * 0x9e3779b97f4a7c15ull);
+
+    for (unsigned char c : data)
+    {
+        h ^= c;
+        h *= 1099511628211ull;
+    }
+
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+
+    return h;
+}
+
+inline std::size_t align(std::size_t offset)
+{
+    return (offset + 7) & ~std::size_t{7};
+}
+
+// collects the constants and writes the database
+class builder
+{
+public:
+
+    void add(std::string_view name, kind type, std::int64_t value,
+             std::string_view payload = {}, std::uint8_t scale = 0)
+    {
+        entry e{};
+        e.name = static_cast<std::uint32_t>(pool_.size());
+        e.name_size = static_cast<std::uint32_t>(name.size());
+        e.type = type;
+        e.scale = scale;
+        e.value = value;
+        pool_.append(name);
+
+        if (type == kind::fixed || type == kind::string || type == kind::character)
+        {
+            e.value = static_cast<std::int64_t>(pool_.size());
+            e.size = static_cast<std::uint32_t>(payload.size());
+            pool_.append(payload);
+        }
+        else if (type == kind::big_integer)
+        {
+            // value only gives the sign, keep it on the scale
+            e.scale = value < 0;
+            e.value = static_cast<std::int64_t>(pool_.size());
+            e.size = static_cast<std::uint32_t>(payload.size());
+            pool_.append(payload);
+        }
+
+        if (pool_.size() > std::numeric_limits<std::uint32_t>::max())
+        {
+            throw std::runtime_error("constants database pool overflow");
+        }
+
+        entries_.push_back(e);
+    }
+
+    std::size_t size() const
+    {
+        return entries_.size();
+    }
+
+    void write(const std::string& path, std::uint64_t source_hash) const
+    {
+        const std::size_t n = entries_.size();
+        const std::size_t nb = std::max<std::size_t>(1, (n + 3) / 4);
+
+        auto name = [this](std::uint32_t i) {
+            return std::string_view(pool_.data() + entries_[i].name, entries_[i].name_size);
+        };
+
+        // the perfect hash cannot tell duplicated names apart
+        std::vector<std::string_view> names(n);
+        for (std::uint32_t i = 0; i < n; ++i)
+        {
+            names[i] = name(i);
+        }
+        std::sort(names.begin(), names.end());
+        auto dup = std::adjacent_find(names.begin(), names.end());
+        if (dup != names.end())
+        {
+            throw std::runtime_error("duplicated constant " + std::string(*dup));
+        }
+
+        // hash the keys into buckets
+        std::vector<std::vector<std::uint32_t>> buckets(nb);
+        for (std::uint32_t i = 0; i < n; ++i)
+        {
+            buckets[hash(name(i)) % nb].push_back(i);
+        }
+
+        std::vector<std::uint32_t> order(nb);
+        for (std::uint32_t b = 0; b < nb; ++b)
+        {
+            order[b] = b;
+        }
+        std::stable_sort(order.begin(), order.end(), [&](std::uint32_t a, std::uint32_t b) {
+            return buckets[a].size() > buckets[b].size();
+        });
+
+        // displace the crowded buckets first
+        constexpr std::uint32_t free_slot = std::numeric_limits<std::uint32_t>::max();
+        std::vector<std::int32_t> seeds(nb, 0);
+        std::vector<std::uint32_t> slots(n, free_slot);
+        std::vector<std::uint32_t> taken;
+
+        auto it = order.begin();
+        for (; it != order.end() && buckets[*it].size() > 1; ++it)
+        {
+            const auto& bucket = buckets[*it];
+
+            for (std::int32_t d = 0;; ++d)
+            {
+                if (d == std::numeric_limits<std::int32_t>::max())
+                {
+                    throw std::runtime_error("cannot build the constants perfect hash");
+                }
+
+                taken.clear();
+                for (auto i : bucket)
+                {
+                    std::uint32_t s = static_cast<std::uint32_t>(hash(name(i), d) % n);
+                    if (slots[s] != free_slot
+                        || std::find(taken.begin(), taken.end(), s) != taken.end())
+                    {
+                        break;
+                    }
+                    taken.push_back(s);
+                }
+
+                if (taken.size() == bucket.size())
+                {
+                    for (std::size_t k = 0; k < bucket.size(); ++k)
+                    {
+                        slots[taken[k]] = bucket[k];
+                    }
+                    seeds[*it] = d;
+                    break;
+                }
+            }
+        }
+
+        // single key buckets go straight into the remaining slots
+        std::uint32_t s = 0;
+        for (; it != order.end() && buckets[*it].size() == 1; ++it)
+        {
+            while (slots[s] != free_slot)
+            {
+                ++s;
+            }
+            slots[s] = buckets[*it].front();
+            seeds[*it] = -static_cast<std::int32_t>(s) - 1;
+        }
+
+        // lay out the file
+        header h{};
+        std::memcpy(h.magic, magic, sizeof(magic));
+        h.version = version;
+        h.count = static_cast<std::uint32_t>(n);
+        h.source_hash = source_hash;
+        h.buckets = static_cast<std::uint32_t>(nb);
+        const std::size_t seeds_offset = align(sizeof(header));
+        const std::size_t entries_offset = align(seeds_offset + nb * sizeof(std::int32_t));
+        const std::size_t pool_offset = align(entries_offset + n * sizeof(entry));
+
+        // file offsets are 32 bits
+        if (pool_offset + pool_.size() > std::numeric_limits<std::uint32_t>::max())
+        {
+            throw std::runtime_error("constants database too large");
+        }
+
+        h.seeds = static_cast<std::uint32_t>(seeds_offset);
+        h.entries = static_cast<std::uint32_t>(entries_offset);
+        h.pool = static_cast<std::uint32_t>(pool_offset);
+        h.pool_size = static_cast<std::uint32_t>(pool_.size());
+
+        std::vector<char> image(h.pool + pool_.size(), '\0');
+        std::memcpy(image.data(), &h, sizeof(h));
+        std::memcpy(image.data() + h.seeds, seeds.data(), nb * sizeof(std::int32_t));
+        for (std::size_t slot = 0; slot < n; ++slot)
+        {
+            std::memcpy(image.data() + h.entries + slot * sizeof(entry),
+                        &entries_[slots[slot]], sizeof(entry));
+        }
+        std::memcpy(image.data() + h.pool, pool_.data(), pool_.size());
+
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out.write(image.data(), static_cast<std::streamsize>(image.size()));
+        if (!out)
+        {
+            throw std::runtime_error("cannot write the constants database " + path);
+        }
+    }
+
+private:
+
+    std::vector<entry> entries_;
+    std::string pool_;
+};
+
+// maps a database file and answers the lookups in place
+class database
+{
+public:
+
+    explicit database(const std::string& path)
+    {
+        map(path);
+
+        if (size_ < sizeof(header))
+        {
+            unmap();
+            throw std::runtime_error("invalid constants database " + path);
+        }
+
+        header_ = reinterpret_cast<const header*>(data_);
+
+        if (std::memcmp(header_->magic, magic, sizeof(magic)) != 0
+            || header_->version != version
+            || header_->buckets == 0
+            || header_->seeds < sizeof(header)
+            || header_->seeds % alignof(std::int32_t) != 0
+            || header_->entries % alignof(entry) != 0
+            || header_->seeds + std::size_t{header_->buckets} * sizeof(std::int32_t) > header_->entries
+            || header_->entries + std::size_t{header_->count} * sizeof(entry) > header_->pool
+            || header_->pool + std::size_t{header_->pool_size} > size_)
+        {
+            unmap();
+            throw std::runtime_error("invalid constants database " + path);
+        }
+
+        seeds_ = reinterpret_cast<const std::int32_t*>(data_ + header_->seeds);
+        entries_ = reinterpret_cast<const entry*>(data_ + header_->entries);
+        pool_ = data_ + header_->pool;
+    }
+
+    ~database()
+    {
+        unmap();
+    }
+
+    database(const database&) = delete;
+    database& operator=(const database&) = delete;
+
+    std::size_t size() const
+    {
+        return header_->count;
+    }
+
+    std::uint64_t source_hash() const
+    {
+        return header_->source_hash;
+    }
+
+    const entry* find(std::string_view key) const
+    {
+        if (header_->count == 0)
+        {
+            return nullptr;
+        }
+
+        std::int32_t d = seeds_[hash(key) % header_->buckets];
+        std::uint64_t slot = d < 0 ? static_cast<std::uint64_t>(-(d + 1))
+                                   : hash(key, static_cast<std::uint64_t>(d)) % header_->count;
+
+        if (slot >= header_->count)
+        {
+            return nullptr;
+        }
+
+        const entry& e = entries_[slot];
+        return name(e) == key ? &e : nullptr;
+    }
+
+    std::string_view name(const entry& e) const
+    {
+        return text(e.name, e.name_size);
+    }
+
+    std::string_view payload(const entry& e) const
+    {
+        switch (e.type)
+        {
+            case kind::fixed:
+            case kind::big_integer:
+            case kind::string:
+            case kind::character:
+                return text(static_cast<std::uint64_t>(e.value), e.size);
+            default:
+                return {};
+        }
+    }
+
+    double floating(const entry& e) const
+    {
+        double res;
+        std::memcpy(&res, &e.value, sizeof(res));
+        return res;
+    }
+
+    bool negative(const entry& e) const
+    {
+        switch (e.type)
+        {
+            case kind::big_integer:
+                return e.scale != 0;
+            case kind::unsigned_integer:
+                return false;
+            default:
+                return e.value < 0;
+        }
+    }
+
+private:
+
+    std::string_view text(std::uint64_t offset, std::uint64_t size) const
+    {
+        if (offset > header_->pool_size || size > header_->pool_size - offset)
+        {
+            return {};
+        }
+
+        return std::string_view(pool_ + offset, static_cast<std::size_t>(size));
+    }
+
+#ifdef _WIN32
+    void map(const std::string& path)
+    {
+        file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        LARGE_INTEGER size;
+        if (file_ == INVALID_HANDLE_VALUE || !GetFileSizeEx(file_, &size))
+        {
+            unmap();
+            throw std::runtime_error("cannot open the constants database " + path);
+        }
+
+        size_ = static_cast<std::size_t>(size.QuadPart);
+        if (size_ == 0)
+        {
+            return;
+        }
+
+        mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping_)
+        {
+            data_ = static_cast<const char*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+        }
+
+        if (!data_)
+        {
+            unmap();
+            throw std::runtime_error("cannot map the constants database " + path);
+        }
+    }
+
+    void unmap()
+    {
+        if (data_)
+        {
+            UnmapViewOfFile(data_);
+        }
+        if (mapping_)
+        {
+            CloseHandle(mapping_);
+        }
+        if (file_ != INVALID_HANDLE_VALUE)
+        {
+            CloseHandle(file_);
+        }
+
+        data_ = nullptr;
+        mapping_ = nullptr;
+        file_ = INVALID_HANDLE_VALUE;
+        size_ = 0;
+    }
+
+    HANDLE file_ = INVALID_HANDLE_VALUE;
+    HANDLE mapping_ = nullptr;
+#else
+    void map(const std::string& path)
+    {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        struct stat st;
+        if (fd < 0 || ::fstat(fd, &st) != 0)
+        {
+            if (fd >= 0)
+            {
+                ::close(fd);
+            }
+            throw std::runtime_error("cannot open the constants database " + path);
+        }
+
+        size_ = static_cast<std::size_t>(st.st_size);
+        if (size_ == 0)
+        {
+            ::close(fd);
+            return;
+        }
+
+        void* p = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+
+        if (p == MAP_FAILED)
+        {
+            size_ = 0;
+            throw std::runtime_error("cannot map the constants database " + path);
+        }
+
+        data_ = static_cast<const char*>(p);
+    }
+
+    void unmap()
+    {
+        if (data_)
+        {
+            ::munmap(const_cast<char*>(data_), size_);
+        }
+
+        data_ = nullptr;
+        size_ = 0;
+    }
+#endif
+
+    const char* data_ = nullptr;
+    std::size_t size_ = 0;
+    const header* header_ = nullptr;
+    const std::int32_t* seeds_ = nullptr;
+    const entry* entries_ = nullptr;
+    const char* pool_ = nullptr;
+};
+
+} // namespace constdb
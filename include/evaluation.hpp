@@ -0,0 +1,208 @@
+// vim: tags+=~/Documents/DHI/PEGTL/taopeg.tags
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+/* in-process const expression evaluation */
+
+// A context owns the evaluation buffers, once they grow to the expressions depth the
+// calls do not allocate. Contexts share no state: use one per thread.
+
+namespace evaluation {
+
+enum class status : std::uint8_t
+{
+    ok,
+    syntax_error,
+    unknown_identifier,
+    bad_operands,
+    division_by_zero,
+    out_of_range
+};
+
+const char* to_string(status s);
+
+// all integers are managed as long long
+// all floats (fixed included) are managed as long double (in MSVC will be an actual double)
+struct value
+{
+    enum class kind : std::uint8_t
+    {
+        // ordered by promotion priority
+        boolean,
+        integer,
+        floating,
+        opaque      // handle to a caller value the calculator cannot operate on
+    };
+
+    kind type = kind::integer;
+
+    union
+    {
+        bool b;
+        long long i = 0;
+        long double f;
+        std::size_t handle;
+    };
+};
+
+inline value make_value(bool b)
+{
+    value v;
+    v.type = value::kind::boolean;
+    v.b = b;
+    return v;
+}
+
+inline value make_value(long long i)
+{
+    value v;
+    v.type = value::kind::integer;
+    v.i = i;
+    return v;
+}
+
+inline value make_value(long double f)
+{
+    value v;
+    v.type = value::kind::floating;
+    v.f = f;
+    return v;
+}
+
+inline value make_opaque(std::size_t handle)
+{
+    value v;
+    v.type = value::kind::opaque;
+    v.handle = handle;
+    return v;
+}
+
+// calculator working stack, keeps the first failure
+class stack
+{
+public:
+
+    void reserve(std::size_t depth)
+    {
+        values_.reserve(depth);
+    }
+
+    void clear()
+    {
+        values_.clear();
+        error_ = status::ok;
+        position_ = 0;
+        furthest_ = 0;
+    }
+
+    void push(const value& v)
+    {
+        values_.push_back(v);
+    }
+
+    value pop()
+    {
+        value v = values_.back();
+        values_.pop_back();
+        return v;
+    }
+
+    value& top()
+    {
+        return values_.back();
+    }
+
+    const value& top() const
+    {
+        return values_.back();
+    }
+
+    std::size_t size() const
+    {
+        return values_.size();
+    }
+
+    bool ok() const
+    {
+        return error_ == status::ok;
+    }
+
+    void fail(status e, std::size_t position)
+    {
+        if (ok())
+        {
+            error_ = e;
+            position_ = position;
+        }
+    }
+
+    status error() const
+    {
+        return error_;
+    }
+
+    // byte offset of the failure within the expression
+    std::size_t position() const
+    {
+        return position_;
+    }
+
+    // the parser keeps the furthest offset a rule failed at, syntax errors are reported there
+    void reach(std::size_t position)
+    {
+        if (position > furthest_)
+        {
+            furthest_ = position;
+        }
+    }
+
+    std::size_t furthest() const
+    {
+        return furthest_;
+    }
+
+private:
+
+    std::vector<value> values_;
+    status error_ = status::ok;
+    std::size_t position_ = 0;
+    std::size_t furthest_ = 0;
+};
+
+struct result
+{
+    status error = status::ok;
+    std::size_t position = 0; // byte offset of the failure (or the syntax error) within the expression
+    value val;
+
+    explicit operator bool() const
+    {
+        return error == status::ok;
+    }
+};
+
+class context
+{
+public:
+
+    explicit context(std::size_t depth = 64)
+    {
+        stack_.reserve(depth);
+    }
+
+    // checks the expression syntax
+    result parse(std::string_view expression);
+
+    // parses and calculates the expression
+    result evaluate(std::string_view expression);
+
+private:
+
+    stack stack_;
+};
+
+} // namespace evaluation
@@ -32,14 +32,15 @@ using kw_exp = one<'e', 'E'>;
 struct decimal_exponent : seq<kw_exp, opt<one<'-'>>, plus<digit>> {};
 struct float_literal : seq< not_at<fixed_pt_literal>,
                             opt<one<'-'>>,
-                            not_at<seq<dot, kw_exp>>,
+                            at<sor<digit, seq<dot, digit>>>, // E1 is a name
                             star<digit>,
-                            opt<seq<dot, star<digit>>>,
-                            decimal_exponent> {};
+                            sor<seq<dot, star<digit>, opt<decimal_exponent>>,
+                                decimal_exponent>> {};
 
 // fixed-point literals
 using kw_fixed = one<'d', 'D'>;
 struct fixed_pt_literal : seq< opt<one<'-'>>,
+                               not_at<kw_fixed>,
                                not_at<seq<dot, kw_fixed>>,
                                star<digit>,
                                opt< seq<dot, star<digit>>>,
@@ -112,7 +113,10 @@ struct div_op : pad<one<'/'>, ws> {};
 struct mod_op : pad<one<'%'>, ws> {};
 struct neg_op : pad<one<'~'>, ws> {};
 
-struct scoped_or_literal : sor<literal, plus<alnum>> {}; // for now
+struct idl_identifier : seq<sor<alpha, one<'_'>>, star<sor<alnum, one<'_'>>>> {};
+struct scoped_name : seq<opt<two<':'>>, list<idl_identifier, two<':'>>> {};
+// a literal cannot be the prefix of a name (TRUE_VALUE, Lx)
+struct scoped_or_literal : sor<seq<at<literal, not_at<sor<alnum, one<'_'>>>>, literal>, scoped_name> {};
 struct const_expr; // forward declaration
 struct primary_expr : sor<seq<open_parentheses, const_expr, close_parentheses>, scoped_or_literal> {};
 
@@ -124,29 +128,63 @@ struct unary_expr : sor<inv_exec,
                         minus_exec,
                         primary_expr> {};
 
-struct mult_expr;
-struct mod_exec : seq<mod_op, mult_expr> {};
-struct div_exec : seq<div_op, mult_expr> {};
-struct mult_exec : seq<mult_op, mult_expr> {};
-struct mult_expr : seq<unary_expr, opt<sor<mod_exec, div_exec, mult_exec>>> {};
-
-struct add_expr;
-struct sub_exec : seq<sub_op, add_expr> {};
-struct add_exec : seq<add_op, add_expr> {};
-struct add_expr : seq<mult_expr, opt<sor<sub_exec, add_exec>>> {};
-
-struct shift_expr;
-struct lshift_exec : seq<lshift_op, shift_expr> {};
-struct rshift_exec : seq<rshift_op, shift_expr> {};
-struct shift_expr : seq<add_expr, opt<sor<lshift_exec, rshift_exec>>> {};
-
-struct and_expr;
-struct and_exec : seq<and_op, and_expr> {};
-struct and_expr : seq<shift_expr, opt<and_exec>> {};
-
-struct xor_expr;
-struct xor_exec : seq<xor_op, xor_expr> {};
-struct xor_expr : seq<and_expr, opt<xor_exec>> {};
-
-struct or_exec : seq<or_op, const_expr> {};
-struct const_expr : seq<xor_expr, opt<or_exec>> {};
+// binary operations are left-associative: every operator applies to the accumulated result
+struct mod_exec : seq<mod_op, unary_expr> {};
+struct div_exec : seq<div_op, unary_expr> {};
+struct mult_exec : seq<mult_op, unary_expr> {};
+struct mult_expr : seq<unary_expr, star<sor<mod_exec, div_exec, mult_exec>>> {};
+
+struct sub_exec : seq<sub_op, mult_expr> {};
+struct add_exec : seq<add_op, mult_expr> {};
+struct add_expr : seq<mult_expr, star<sor<sub_exec, add_exec>>> {};
+
+struct lshift_exec : seq<lshift_op, add_expr> {};
+struct rshift_exec : seq<rshift_op, add_expr> {};
+struct shift_expr : seq<add_expr, star<sor<lshift_exec, rshift_exec>>> {};
+
+struct and_exec : seq<and_op, shift_expr> {};
+struct and_expr : seq<shift_expr, star<and_exec>> {};
+
+struct xor_exec : seq<xor_op, and_expr> {};
+struct xor_expr : seq<and_expr, star<xor_exec>> {};
+
+struct or_exec : seq<or_op, xor_expr> {};
+struct const_expr : seq<xor_expr, star<or_exec>> {};
+
+// const declaration grammar
+struct kw_const : TAO_PEGTL_KEYWORD("const") {};
+struct type_args : seq<one<'<'>, star<sor<type_args, not_one<'<', '>'>>>, one<'>'>> {};
+struct type_word : seq<opt<two<':'>>, list<idl_identifier, two<':'>>, opt<type_args>> {};
+struct const_type : seq<type_word, star<ws, type_word, at<ws, type_word>>> {}; // the last word is the name
+struct const_name : idl_identifier {};
+struct const_value : seq<const_expr> {};
+struct const_dcl : seq<kw_const, ws, const_type, ws, const_name, equal_op, const_value, star<space>, one<';'>> {};
+
+struct line_comment : seq<two<'/'>, until<eolf>> {};
+struct block_comment : seq<TAO_PEGTL_STRING("/*"), until<TAO_PEGTL_STRING("*/")>> {};
+struct preprocessor : seq<one<'#'>, until<eolf>> {};
+struct ignored : sor<space, line_comment, block_comment, preprocessor> {};
+
+// modules scope their declarations, any other declaration is skipped but its names are kept
+struct kw_module : TAO_PEGTL_KEYWORD("module") {};
+struct module_name : idl_identifier {};
+struct module_open : seq<kw_module, ws, module_name, star<ignored>, one<'{'>> {};
+struct module_close : seq<one<'}'>, star<ignored>, one<';'>> {};
+struct skipped_name : scoped_name {}; // array bounds, template arguments, cases...
+struct skipped_number : seq<digit, star<sor<alnum, one<'_', '.'>>>> {};
+struct skipped_word : sor<line_comment,
+                          block_comment,
+                          wide_string_literal,
+                          wide_character_literal,
+                          string_literal,
+                          character_literal,
+                          skipped_number,
+                          skipped_name> {};
+struct skipped_body : seq<one<'{'>, star<sor<skipped_word, skipped_body, not_one<'{', '}'>>>, one<'}'>> {};
+struct skipped_dcl : seq<not_at<kw_const>,
+                         not_at<module_open>,
+                         plus<sor<skipped_word, skipped_body, not_one<';', '{', '}'>>>,
+                         one<';'>> {};
+struct definition : sor<const_dcl, module_open, module_close, skipped_dcl> {};
+
+struct specification : seq<star<ignored>, star<definition, star<ignored>>, eof> {};
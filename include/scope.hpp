@@ -0,0 +1,90 @@
+// vim: tags+=~/Documents/DHI/PEGTL/taopeg.tags
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+/* IDL module scopes */
+
+// Declarations are named by their fully scoped name without the leading "::" (Mod::X).
+// References are resolved from the innermost enclosing module outwards.
+
+namespace scope {
+
+// modules enclosing the declarations being parsed
+class path
+{
+public:
+
+    void open(std::string_view module)
+    {
+        sizes_.push_back(name_.size());
+        name_ += name_.empty() ? "" : "::";
+        name_ += module;
+    }
+
+    // unbalanced closes are ignored
+    void close()
+    {
+        if (!sizes_.empty())
+        {
+            name_.resize(sizes_.back());
+            sizes_.pop_back();
+        }
+    }
+
+    // empty at the global scope
+    const std::string& name() const
+    {
+        return name_;
+    }
+
+    std::string qualify(std::string_view declaration) const
+    {
+        std::string res = name_;
+        res += name_.empty() ? "" : "::";
+        res += declaration;
+        return res;
+    }
+
+private:
+
+    std::string name_;
+    std::vector<std::size_t> sizes_;
+};
+
+// Offers the candidate names of a reference made within the scope, innermost first
+// (A::B::N, A::N, N), until the accept callback takes one. Fully scoped references
+// (::N) have a single candidate. The buffer holds the accepted candidate.
+template<typename Accept>
+bool resolve(std::string_view scope, std::string_view reference, std::string& buffer, Accept accept)
+{
+    if (reference.substr(0, 2) == "::")
+    {
+        buffer.assign(reference.substr(2));
+        return accept(std::string_view(buffer));
+    }
+
+    for (;;)
+    {
+        buffer.assign(scope);
+        buffer += scope.empty() ? "" : "::";
+        buffer += reference;
+
+        if (accept(std::string_view(buffer)))
+        {
+            return true;
+        }
+
+        if (scope.empty())
+        {
+            return false;
+        }
+
+        std::size_t last = scope.rfind("::");
+        scope = last == std::string_view::npos ? std::string_view{} : scope.substr(0, last);
+    }
+}
+
+} // namespace scope
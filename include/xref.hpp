@@ -0,0 +1,190 @@
+// vim: tags+=~/Documents/DHI/PEGTL/taopeg.tags
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <scope.hpp>
+
+/* identifier cross-reference index */
+
+// Names are interned once, every occurrence is kept as ids on two sorted arrays:
+// + by name: who uses an identifier
+// + by user: what a constant uses
+// Constants are declared by their scoped name (Mod::X), references are recorded as written
+// and resolved against the declarations when sorting.
+
+namespace xref {
+
+using id = std::uint32_t;
+constexpr id none = std::numeric_limits<id>::max();
+
+struct occurrence
+{
+    id name;                // identifier referenced
+    id user;                // constant whose value references it (none outside declarations)
+    id file;
+    std::uint32_t offset;   // byte offset in the file
+};
+
+template<typename T>
+struct range
+{
+    const T* first = nullptr;
+    const T* last = nullptr;
+
+    const T* begin() const { return first; }
+    const T* end() const { return last; }
+    std::size_t size() const { return last - first; }
+    bool empty() const { return first == last; }
+};
+
+class index
+{
+public:
+
+    id intern(std::string_view name)
+    {
+        auto it = ids_.find(name);
+        if (it != ids_.end())
+        {
+            return it->second;
+        }
+
+        id res = static_cast<id>(names_.size());
+        names_.emplace_back(name);
+        ids_.emplace(names_.back(), res);
+        return res;
+    }
+
+    // none if the name was never seen
+    id find(std::string_view name) const
+    {
+        auto it = ids_.find(name);
+        return it != ids_.end() ? it->second : none;
+    }
+
+    std::string_view name(id n) const
+    {
+        return names_[n];
+    }
+
+    id add_file(std::string path)
+    {
+        files_.push_back(std::move(path));
+        return static_cast<id>(files_.size() - 1);
+    }
+
+    const std::string& file(id f) const
+    {
+        return files_[f];
+    }
+
+    void declare(id name, id file, std::uint32_t offset)
+    {
+        declarations_.push_back({name, none, file, offset});
+
+        if (declared_.size() <= name)
+        {
+            declared_.resize(name + 1, false);
+        }
+        declared_[name] = true;
+    }
+
+    bool declared(id name) const
+    {
+        return name < declared_.size() && declared_[name];
+    }
+
+    // within: interned module path the reference was made from (none for the global scope)
+    void record(id name, id within, id user, id file, std::uint32_t offset)
+    {
+        pending_.push_back({{name, user, file, offset}, within});
+    }
+
+    // resolves and sorts the occurrences, required before any query
+    void sort()
+    {
+        // names that resolve to no declaration (types, members...) are kept as written
+        std::string candidate;
+        for (const auto& p : pending_)
+        {
+            occurrence o = p.first;
+            std::string_view path = p.second == none ? std::string_view{} : name(p.second);
+
+            scope::resolve(path, name(o.name), candidate, [&](std::string_view c) {
+                id n = find(c);
+                if (!declared(n))
+                {
+                    return false;
+                }
+                o.name = n;
+                return true;
+            });
+
+            by_name_.push_back(o);
+        }
+        pending_.clear();
+
+        std::sort(by_name_.begin(), by_name_.end(), [](const occurrence& a, const occurrence& b) {
+            return std::tie(a.name, a.user, a.file, a.offset) < std::tie(b.name, b.user, b.file, b.offset);
+        });
+
+        by_user_ = by_name_;
+        std::sort(by_user_.begin(), by_user_.end(), [](const occurrence& a, const occurrence& b) {
+            return std::tie(a.user, a.name, a.file, a.offset) < std::tie(b.user, b.name, b.file, b.offset);
+        });
+    }
+
+    std::size_t size() const
+    {
+        return by_name_.size() + pending_.size();
+    }
+
+    const std::vector<occurrence>& declarations() const
+    {
+        return declarations_;
+    }
+
+    // occurrences of the identifier grouped by user
+    range<occurrence> users(id name) const
+    {
+        auto r = std::equal_range(by_name_.begin(), by_name_.end(), occurrence{name, 0, 0, 0},
+            [](const occurrence& a, const occurrence& b) { return a.name < b.name; });
+        return {by_name_.data() + (r.first - by_name_.begin()), by_name_.data() + (r.second - by_name_.begin())};
+    }
+
+    // occurrences within the constant value grouped by identifier
+    range<occurrence> uses(id user) const
+    {
+        auto r = std::equal_range(by_user_.begin(), by_user_.end(), occurrence{0, user, 0, 0},
+            [](const occurrence& a, const occurrence& b) { return a.user < b.user; });
+        return {by_user_.data() + (r.first - by_user_.begin()), by_user_.data() + (r.second - by_user_.begin())};
+    }
+
+    bool used(id name) const
+    {
+        return !users(name).empty();
+    }
+
+private:
+
+    std::deque<std::string> names_; // stable storage for the map keys
+    std::unordered_map<std::string_view, id> ids_;
+    std::vector<std::string> files_;
+    std::vector<occurrence> declarations_;
+    std::vector<bool> declared_;
+    std::vector<std::pair<occurrence, id>> pending_; // references and their scope
+    std::vector<occurrence> by_name_;
+    std::vector<occurrence> by_user_;
+};
+
+} // namespace xref
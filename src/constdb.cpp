@@ -0,0 +1,858 @@
+// vim: tags+=~/Documents/DHI/PEGTL/taopeg.tags
+
+#include <cctype>
+#include <charconv>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include <tao/pegtl/contrib/analyze.hpp>
+
+#include <calculator.hpp>
+#include <constdb.hpp>
+#include <scope.hpp>
+
+using namespace std;
+
+// string and character constants cannot be calculated, only referenced (as opaque values)
+struct text_value
+{
+    constdb::kind type;
+    std::string text;
+};
+
+// Type a constant is declared with, the value is converted to it. Typedefs and
+// enumerations are unknown: the value keeps the kind it evaluates to.
+struct declared_type
+{
+    bool known = false;
+    constdb::kind type = constdb::kind::integer;
+    long long min = 0;              // integer range
+    unsigned long long max = 0;
+    std::uint8_t digits = 0;        // fixed<digits, scale>, 0 if not given
+    std::uint8_t scale = 0;
+};
+
+declared_type declare_type(std::string_view text)
+{
+    // single spaces between words, none around the template arguments
+    std::string name;
+    for (unsigned char c : text)
+    {
+        if (isspace(c))
+        {
+            if (!name.empty() && name.back() != ' ' && name.back() != '<' && name.back() != ',')
+            {
+                name += ' ';
+            }
+            continue;
+        }
+        if ((c == '<' || c == ',' || c == '>') && !name.empty() && name.back() == ' ')
+        {
+            name.pop_back();
+        }
+        name += static_cast<char>(c);
+    }
+
+    struct integer_type
+    {
+        const char* name;
+        long long min;
+        unsigned long long max;
+    };
+
+    static const integer_type integers[] = {
+        {"short", INT16_MIN, INT16_MAX},
+        {"int16", INT16_MIN, INT16_MAX},
+        {"long", INT32_MIN, INT32_MAX},
+        {"int32", INT32_MIN, INT32_MAX},
+        {"long long", LLONG_MIN, LLONG_MAX},
+        {"int64", LLONG_MIN, LLONG_MAX},
+        {"int8", INT8_MIN, INT8_MAX},
+        {"octet", 0, UINT8_MAX},
+        {"uint8", 0, UINT8_MAX},
+        {"unsigned short", 0, UINT16_MAX},
+        {"uint16", 0, UINT16_MAX},
+        {"unsigned long", 0, UINT32_MAX},
+        {"uint32", 0, UINT32_MAX},
+        {"unsigned long long", 0, ULLONG_MAX},
+        {"uint64", 0, ULLONG_MAX}};
+
+    declared_type res;
+    res.known = true;
+
+    for (const auto& i : integers)
+    {
+        if (name == i.name)
+        {
+            res.type = i.min < 0 ? constdb::kind::integer : constdb::kind::unsigned_integer;
+            res.min = i.min;
+            res.max = i.max;
+            return res;
+        }
+    }
+
+    unsigned digits = 0, scale = 0;
+    char close = 0;
+
+    if (name == "boolean")
+    {
+        res.type = constdb::kind::boolean;
+    }
+    else if (name == "float" || name == "double" || name == "long double")
+    {
+        res.type = constdb::kind::floating;
+    }
+    else if (name == "char" || name == "wchar")
+    {
+        res.type = constdb::kind::character;
+    }
+    else if (name == "string" || name == "wstring"
+             || name.rfind("string<", 0) == 0 || name.rfind("wstring<", 0) == 0)
+    {
+        res.type = constdb::kind::string;
+    }
+    else if (name == "fixed")
+    {
+        res.type = constdb::kind::fixed;
+    }
+    else if (std::sscanf(name.c_str(), "fixed<%u,%u%c", &digits, &scale, &close) == 3
+             && close == '>' && scale <= digits && digits <= 31)
+    {
+        res.type = constdb::kind::fixed;
+        res.digits = static_cast<std::uint8_t>(digits);
+        res.scale = static_cast<std::uint8_t>(scale);
+    }
+    else
+    {
+        res.known = false;
+    }
+
+    return res;
+}
+
+// marks the constants the calculator cannot hold (big integers)
+constexpr std::size_t out_of_range_handle = std::numeric_limits<std::size_t>::max();
+
+struct export_state
+{
+    calc_stack stack;
+    std::string name;                        // scoped name of the constant being exported
+    declared_type type;
+    std::map<std::string, calc_value, std::less<>> known; // constants exported so far
+    std::vector<text_value> texts;
+    constdb::builder db;
+    scope::path modules;
+    std::string module;                      // module being opened
+    std::string candidate;                   // reference resolution buffer
+    std::size_t failures = 0;
+};
+
+// the constant is left out of the database, the export goes on
+void export_fail(export_state& st, const std::string& reason)
+{
+    cerr << st.name << ": " << reason << endl;
+    ++st.failures;
+    st.stack.clear();
+}
+
+// Literal classification
+template<typename Rule>
+struct kind_action : nothing<Rule> {};
+
+#define kind_specialization(Rule, k) \
+template<> \
+struct kind_action<Rule> \
+{ \
+    template<typename Input> \
+    static void apply(const Input&, constdb::kind& t) \
+    { \
+        t = constdb::kind::k; \
+    } \
+};
+
+kind_specialization(boolean_literal, boolean)
+kind_specialization(integer_literal, integer)
+kind_specialization(float_literal, floating)
+kind_specialization(fixed_pt_literal, fixed)
+kind_specialization(character_literal, character)
+kind_specialization(wide_character_literal, character)
+kind_specialization(string_literal, string)
+kind_specialization(wide_string_literal, string)
+
+// true if the text is a single literal
+bool literal_kind(const std::string& text, constdb::kind& t)
+{
+    pegtl::memory_input in(text.data(), text.size(), "");
+    return pegtl::parse<seq<literal, eof>, kind_action>(in, t);
+}
+
+// concatenates the quoted parts of a string or char literal resolving the escape sequences
+std::string unescape(const std::string& text)
+{
+    std::string res;
+    char quote = 0;
+
+    auto number = [&](std::size_t& i, int base, int max) {
+        unsigned long v = 0;
+        for (int n = 0; n < max && i + 1 < text.size(); ++n)
+        {
+            unsigned char c = text[i + 1];
+            int d = isdigit(c) ? c - '0' : isxdigit(c) ? (tolower(c) - 'a' + 10) : base;
+            if (d >= base)
+            {
+                break;
+            }
+            v = v * base + d;
+            ++i;
+        }
+        return v;
+    };
+
+    for (std::size_t i = 0; i < text.size(); ++i)
+    {
+        char c = text[i];
+
+        if (!quote)
+        {
+            // skip prefixes and separators
+            if (c == '"' || c == '\'')
+            {
+                quote = c;
+            }
+            continue;
+        }
+
+        if (c == quote)
+        {
+            quote = 0;
+            continue;
+        }
+
+        if (c != '\\' || i + 1 == text.size())
+        {
+            res += c;
+            continue;
+        }
+
+        switch (c = text[++i])
+        {
+            case 'n': res += '\n'; break;
+            case 't': res += '\t'; break;
+            case 'v': res += '\v'; break;
+            case 'b': res += '\b'; break;
+            case 'r': res += '\r'; break;
+            case 'f': res += '\f'; break;
+            case 'a': res += '\a'; break;
+            case 'x': res += static_cast<char>(number(i, 16, 2)); break;
+            case 'u':
+            {
+                // utf8 encoding
+                unsigned long cp = number(i, 16, 4);
+                if (cp < 0x80)
+                {
+                    res += static_cast<char>(cp);
+                }
+                else if (cp < 0x800)
+                {
+                    res += static_cast<char>(0xC0 | (cp >> 6));
+                    res += static_cast<char>(0x80 | (cp & 0x3F));
+                }
+                else
+                {
+                    res += static_cast<char>(0xE0 | (cp >> 12));
+                    res += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+                    res += static_cast<char>(0x80 | (cp & 0x3F));
+                }
+                break;
+            }
+            default:
+                if (c >= '0' && c <= '7')
+                {
+                    --i;
+                    res += static_cast<char>(number(i, 8, 3));
+                }
+                else
+                {
+                    res += c; // \\ \? \' \"
+                }
+        }
+    }
+
+    return res;
+}
+
+// fixed point literal as (maybe signed) digits and the number of fractional ones
+std::string fixed_digits(const std::string& text, std::uint8_t& scale)
+{
+    std::string digits, fraction;
+    bool negative = false, dot = false;
+
+    for (unsigned char c : text)
+    {
+        if (c == '-')
+        {
+            negative = true;
+        }
+        else if (c == '.')
+        {
+            dot = true;
+        }
+        else if (isdigit(c))
+        {
+            (dot ? fraction : digits) += c;
+        }
+    }
+
+    if (fraction.size() > std::numeric_limits<std::uint8_t>::max())
+    {
+        throw runtime_error("too many fractional digits in " + text);
+    }
+
+    scale = static_cast<std::uint8_t>(fraction.size());
+    digits += fraction;
+    digits.erase(0, std::min(digits.find_first_not_of('0'), digits.size() - fraction.size()));
+
+    return (negative ? "-" : "") + digits;
+}
+
+// integer literal as little endian magnitude
+std::string magnitude(const std::string& text, bool& negative)
+{
+    std::string res;
+    std::size_t i = 0;
+    int base = 10;
+
+    negative = text[i] == '-';
+    i += negative;
+
+    if (text.size() > i + 1 && text[i] == '0')
+    {
+        bool hexa = text[i + 1] == 'x' || text[i + 1] == 'X';
+        base = hexa ? 16 : 8;
+        i += hexa ? 2 : 1;
+    }
+
+    for (; i < text.size(); ++i)
+    {
+        unsigned char c = text[i];
+        unsigned carry = isdigit(c) ? c - '0' : tolower(c) - 'a' + 10;
+
+        for (auto& b : res)
+        {
+            unsigned v = static_cast<unsigned char>(b) * base + carry;
+            b = static_cast<char>(v & 0xFF);
+            carry = v >> 8;
+        }
+
+        for (; carry; carry >>= 8)
+        {
+            res += static_cast<char>(carry & 0xFF);
+        }
+    }
+
+    return res;
+}
+
+// true if the integer literal fits on a long long
+bool fits(const std::string& text)
+{
+    bool negative;
+    std::string bytes = magnitude(text, negative);
+    return bytes.size() < sizeof(long long)
+        || (bytes.size() == sizeof(long long) && static_cast<unsigned char>(bytes.back()) < 0x80);
+}
+
+// fixed point digits of a calculated value, rounded to the declared scale if any
+bool fixed_value(const calc_value& value, const declared_type& d, std::string& digits, std::uint8_t& scale)
+{
+    char buffer[512];
+    std::to_chars_result r;
+
+    if (calc_value::kind::integer == value.type)
+    {
+        r = std::to_chars(buffer, buffer + sizeof(buffer), value.i);
+    }
+    else
+    {
+        double f = static_cast<double>(value.f);
+        r = d.digits ? std::to_chars(buffer, buffer + sizeof(buffer), f, std::chars_format::fixed, d.scale)
+                     : std::to_chars(buffer, buffer + sizeof(buffer), f, std::chars_format::fixed);
+    }
+
+    if (r.ec != std::errc{})
+    {
+        return false;
+    }
+
+    digits = fixed_digits(std::string(buffer, r.ptr), scale);
+    return true;
+}
+
+// adapts the digits to fixed<digits, scale>, false if they do not fit
+bool fixed_fit(const declared_type& d, std::string& digits, std::uint8_t& scale)
+{
+    if (!d.digits)
+    {
+        return true;
+    }
+
+    // dropped fractional digits must be zeros
+    for (; scale > d.scale; --scale)
+    {
+        if (digits.back() != '0')
+        {
+            return false;
+        }
+        digits.pop_back();
+    }
+    for (; scale < d.scale; ++scale)
+    {
+        digits += '0';
+    }
+
+    std::size_t first = digits.find_first_not_of("-0");
+    return first == std::string::npos || digits.size() - first <= d.digits;
+}
+
+// Actions
+// evaluate the expressions with the calculator and export the results
+template<typename Rule, typename = void>
+struct export_calc : nothing<Rule> {};
+
+template<typename Rule>
+struct export_calc<Rule, std::void_t<decltype(calc_action<Rule>::id)>>
+{
+    template<typename Input>
+    static void apply(const Input& in, export_state& st)
+    {
+        calc_action<Rule>::apply(in, st.stack);
+    }
+};
+
+template<typename Rule>
+struct export_action : export_calc<Rule> {};
+
+// reference to a previous constant
+template<>
+struct export_action<scoped_name>
+{
+    template<typename Input>
+    static void apply(const Input& in, export_state& st)
+    {
+        if ( !st.stack.ok() ) return;
+
+        auto it = st.known.end();
+        scope::resolve(st.modules.name(), in.string_view(), st.candidate, [&](std::string_view c) {
+            it = st.known.find(c);
+            return it != st.known.end();
+        });
+
+        if (it == st.known.end())
+        {
+            calc_fail(st.stack, calc_status::unknown_identifier, in);
+            return;
+        }
+        if (calc_value::kind::opaque == it->second.type && it->second.handle == out_of_range_handle)
+        {
+            calc_fail(st.stack, calc_status::out_of_range, in);
+            return;
+        }
+        st.stack.push(it->second);
+    }
+};
+
+#define text_specialization(Rule, k) \
+template<> \
+struct export_action<Rule> \
+{ \
+    template<typename Input> \
+    static void apply(const Input& in, export_state& st) \
+    { \
+        if ( !st.stack.ok() ) return; \
+ \
+        st.texts.push_back({constdb::kind::k, unescape(in.string())}); \
+        st.stack.push(evaluation::make_opaque(st.texts.size() - 1)); \
+    } \
+};
+
+text_specialization(character_literal, character)
+text_specialization(wide_character_literal, character)
+text_specialization(string_literal, string)
+text_specialization(wide_string_literal, string)
+
+template<>
+struct export_action<const_type>
+{
+    template<typename Input>
+    static void apply(const Input& in, export_state& st)
+    {
+        st.type = declare_type(in.string_view());
+    }
+};
+
+template<>
+struct export_action<const_name>
+{
+    template<typename Input>
+    static void apply(const Input& in, export_state& st)
+    {
+        st.name = st.modules.qualify(in.string_view());
+    }
+};
+
+template<>
+struct export_action<module_name>
+{
+    template<typename Input>
+    static void apply(const Input& in, export_state& st)
+    {
+        st.module = in.string();
+    }
+};
+
+template<>
+struct export_action<module_open>
+{
+    template<typename Input>
+    static void apply(const Input&, export_state& st)
+    {
+        st.modules.open(st.module);
+    }
+};
+
+template<>
+struct export_action<module_close>
+{
+    template<typename Input>
+    static void apply(const Input&, export_state& st)
+    {
+        st.modules.close();
+    }
+};
+
+template<>
+struct export_action<const_value>
+{
+    template<typename Input>
+    static void apply(const Input& in, export_state& st)
+    {
+        if (st.known.count(st.name))
+        {
+            export_fail(st, "duplicated constant");
+            return;
+        }
+
+        const std::string text = in.string();
+        const declared_type& d = st.type;
+        constdb::kind t;
+        bool bare = literal_kind(text, t);
+
+        // single literals keep their exact value
+        if (bare && t == constdb::kind::integer && !fits(text))
+        {
+            // the calculator cannot hold it
+            bool negative;
+            std::string bytes = magnitude(text, negative);
+
+            if (!d.known)
+            {
+                st.db.add(st.name, constdb::kind::big_integer, negative ? -1 : 1, bytes);
+            }
+            else if (d.type == constdb::kind::unsigned_integer && !negative && bytes.size() <= sizeof(std::uint64_t))
+            {
+                std::uint64_t bits = 0;
+                std::memcpy(&bits, bytes.data(), bytes.size()); // little endian hosts only
+                if (bits > d.max)
+                {
+                    export_fail(st, evaluation::to_string(calc_status::out_of_range));
+                    return;
+                }
+                st.db.add(st.name, constdb::kind::unsigned_integer, static_cast<std::int64_t>(bits));
+            }
+            else
+            {
+                export_fail(st, evaluation::to_string(calc_status::out_of_range));
+                return;
+            }
+
+            st.known[st.name] = evaluation::make_opaque(out_of_range_handle);
+            st.stack.clear();
+            return;
+        }
+
+        if (!st.stack.ok())
+        {
+            export_fail(st, evaluation::to_string(st.stack.error()));
+            return;
+        }
+
+        if (st.stack.size() != 1)
+        {
+            export_fail(st, "cannot evaluate");
+            return;
+        }
+
+        calc_value value = st.stack.top();
+        const constdb::kind k = d.known ? d.type
+                              : bare && t == constdb::kind::fixed ? constdb::kind::fixed
+                              : calc_value::kind::boolean == value.type ? constdb::kind::boolean
+                              : calc_value::kind::integer == value.type ? constdb::kind::integer
+                              : calc_value::kind::floating == value.type ? constdb::kind::floating
+                              : st.texts[value.handle].type;
+        // values of another type do not convert, values out of the type range do not fit
+        const char* failure = nullptr;
+        const char* mismatch = "type mismatch";
+        const char* range = evaluation::to_string(calc_status::out_of_range);
+
+        switch (k)
+        {
+            case constdb::kind::boolean:
+                if (calc_value::kind::boolean != value.type)
+                {
+                    failure = mismatch;
+                    break;
+                }
+                st.db.add(st.name, k, value.b);
+                break;
+            case constdb::kind::integer:
+            case constdb::kind::unsigned_integer:
+                if (calc_value::kind::integer != value.type)
+                {
+                    failure = mismatch;
+                    break;
+                }
+                if (d.known && (value.i < d.min || (value.i > 0 && static_cast<unsigned long long>(value.i) > d.max)))
+                {
+                    failure = range;
+                    break;
+                }
+                st.db.add(st.name, k, value.i);
+                break;
+            case constdb::kind::floating:
+            {
+                if (calc_value::kind::integer != value.type && calc_value::kind::floating != value.type)
+                {
+                    failure = mismatch;
+                    break;
+                }
+                double res = promote<double>(value);
+                std::int64_t bits;
+                std::memcpy(&bits, &res, sizeof(bits));
+                st.db.add(st.name, k, bits);
+                value = evaluation::make_value(static_cast<long double>(res));
+                break;
+            }
+            case constdb::kind::fixed:
+            {
+                if (calc_value::kind::integer != value.type && calc_value::kind::floating != value.type)
+                {
+                    failure = mismatch;
+                    break;
+                }
+                std::string digits;
+                std::uint8_t scale = 0;
+                if (bare && t == constdb::kind::fixed)
+                {
+                    digits = fixed_digits(text, scale);
+                }
+                else if (!fixed_value(value, d, digits, scale))
+                {
+                    failure = range;
+                    break;
+                }
+                if (!fixed_fit(d, digits, scale))
+                {
+                    failure = range;
+                    break;
+                }
+                st.db.add(st.name, k, 0, digits, scale);
+                value = evaluation::make_value(promote<long double>(value));
+                break;
+            }
+            default:
+                if (calc_value::kind::opaque != value.type || st.texts[value.handle].type != k)
+                {
+                    failure = mismatch;
+                    break;
+                }
+                st.db.add(st.name, k, 0, st.texts[value.handle].text);
+                break;
+        }
+
+        if (failure)
+        {
+            export_fail(st, failure);
+            return;
+        }
+
+        st.known[st.name] = value;
+        st.stack.clear();
+    }
+};
+
+std::string render(const constdb::database& db, const constdb::entry& e)
+{
+    ostringstream ss;
+    std::string_view payload = db.payload(e);
+
+    switch (e.type)
+    {
+        case constdb::kind::boolean:
+            ss << (e.value ? "TRUE" : "FALSE");
+            break;
+        case constdb::kind::integer:
+            ss << e.value;
+            break;
+        case constdb::kind::unsigned_integer:
+            ss << static_cast<std::uint64_t>(e.value);
+            break;
+        case constdb::kind::floating:
+            ss << db.floating(e);
+            break;
+        case constdb::kind::fixed:
+        {
+            bool negative = !payload.empty() && payload[0] == '-';
+            std::string digits(payload.substr(negative));
+            if (digits.size() <= e.scale)
+            {
+                digits.insert(0, e.scale + 1 - digits.size(), '0');
+            }
+            if (e.scale)
+            {
+                digits.insert(digits.size() - e.scale, ".");
+            }
+            ss << (negative ? "-" : "") << digits;
+            break;
+        }
+        case constdb::kind::big_integer:
+            ss << (db.negative(e) ? "-" : "") << "0x" << hex;
+            for (auto b = payload.rbegin(); b != payload.rend(); ++b)
+            {
+                ss << (b == payload.rbegin() ? setw(0) : setw(2)) << setfill('0')
+                   << static_cast<unsigned>(static_cast<unsigned char>(*b));
+            }
+            break;
+        case constdb::kind::string:
+        case constdb::kind::character:
+            ss << payload;
+            break;
+    }
+
+    return ss.str();
+}
+
+std::string read_file(const char* path)
+{
+    ifstream file(path, ios::binary);
+    if (!file)
+    {
+        throw runtime_error(std::string("cannot read ") + path);
+    }
+
+    ostringstream ss;
+    ss << file.rdbuf();
+    return ss.str();
+}
+
+int main (int argc, char *argv[])
+{
+    using my_grammar = specification;
+
+    std::size_t issues = tao::pegtl::analyze< my_grammar >(-1);
+    if (issues > 0)
+    {
+        return tao::pegtl::analyze< my_grammar >(1);
+    }
+
+    // expected inputs:
+    // • export <idl files...> <database file>: evaluates the idl constants into the database
+    //   the constants failing to evaluate are reported and left out
+    // • lookup <database file> <constant> <expected value>
+    //   test passes if the constant is found and renders as expected
+    // • check <database file> <idl files...>
+    //   test passes if the database was built from the current idl files
+    if ( argc < 4 )
+        return -1;
+
+    const std::string mode = argv[1];
+    int res = 0;
+
+    try
+    {
+        if (mode == "export")
+        {
+            export_state st;
+            std::uint64_t source_hash = 0;
+
+            // included files must come first
+            for (int i = 2; i < argc - 1 && res == 0; ++i)
+            {
+                const std::string source = read_file(argv[i]);
+                source_hash = constdb::hash(source, source_hash);
+                st.modules = scope::path{};
+
+                pegtl::memory_input in(source.data(), source.size(), argv[i]);
+
+                if( !pegtl::parse<my_grammar, export_action>(in, st) )
+                {
+                    cerr << "I don't understand " << argv[i] << endl;
+                    res = -1;
+                }
+            }
+
+            if (res == 0)
+            {
+                st.db.write(argv[argc - 1], source_hash);
+                cout << "exported " << st.db.size() << " constants, "
+                     << st.failures << " failed" << endl;
+            }
+        }
+        else if (mode == "lookup" && argc == 5)
+        {
+            constdb::database db(argv[2]);
+
+            if (const constdb::entry* e = db.find(argv[3]))
+            {
+                std::string value = render(db, *e);
+                cout << "evaluated result: " << value << endl;
+                cout << "expected result: " << argv[4] << endl;
+                res = value == argv[4] ? 0 : -1;
+            }
+            else {
+                cerr << "unknown constant " << argv[3] << endl;
+                res = -1;
+            }
+        }
+        else if (mode == "check")
+        {
+            constdb::database db(argv[2]);
+            std::uint64_t source_hash = 0;
+            for (int i = 3; i < argc; ++i)
+            {
+                source_hash = constdb::hash(read_file(argv[i]), source_hash);
+            }
+            res = db.source_hash() == source_hash ? 0 : -1;
+        }
+        else {
+            res = -1;
+        }
+    }
+    catch (const std::exception& e)
+    {
+        cerr << e.what() << endl;
+        res = -1;
+    }
+
+    return res;
+}
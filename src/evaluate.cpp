@@ -0,0 +1,103 @@
+// vim: tags+=~/Documents/DHI/PEGTL/taopeg.tags
+
+#include <atomic>
+#include <cctype>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <evaluation.hpp>
+
+using namespace std;
+
+bool matches(const evaluation::result& r, const std::string& expected)
+{
+    if (!r)
+    {
+        return expected == evaluation::to_string(r.error);
+    }
+
+    if (expected.empty() || (!isdigit(static_cast<unsigned char>(expected[0])) && expected[0] != '-'))
+    {
+        return false;
+    }
+
+    switch (r.val.type)
+    {
+        case evaluation::value::kind::boolean:
+            return r.val.b == (atoi(expected.c_str()) != 0);
+        case evaluation::value::kind::integer:
+            return r.val.i == atoll(expected.c_str());
+        case evaluation::value::kind::floating:
+            return static_cast<double>(r.val.f) == atof(expected.c_str());
+        default:
+            return false;
+    }
+}
+
+int main (int argc, char *argv[])
+{
+    // expected inputs:
+    // • expression to evaluate
+    // • expected result or failure (status name)
+    // • optionally, expected failure offset
+    // test passes if repeated evaluations, reusing a context per thread, yield the expected outcome
+    if ( argc < 3 || argc > 4 )
+        return -1;
+
+    const std::string expression = argv[1];
+    const std::string expected = argv[2];
+
+    evaluation::context ctx;
+
+    evaluation::result p = ctx.parse(expression);
+    evaluation::result r = ctx.evaluate(expression);
+
+    cout << "parsing: " << evaluation::to_string(p.error) << " at " << p.position << endl;
+    cout << "evaluation: " << evaluation::to_string(r.error) << " at " << r.position << endl;
+    cout << "expected result: " << expected << endl;
+
+    if (bool(p) != (expected != evaluation::to_string(evaluation::status::syntax_error))
+        || !matches(r, expected))
+    {
+        return -1;
+    }
+
+    if (argc == 4)
+    {
+        // syntax errors are reported at the same offset by both calls
+        std::size_t position = static_cast<std::size_t>(atoll(argv[3]));
+        if (r.position != position || (!p && p.position != position))
+        {
+            return -1;
+        }
+    }
+
+    std::atomic<int> failures{0};
+    std::vector<std::thread> threads;
+
+    for (int t = 0; t < 4; ++t)
+    {
+        threads.emplace_back([&]() {
+            evaluation::context local;
+            for (int i = 0; i < 1000; ++i)
+            {
+                if (!matches(local.evaluate(expression), expected))
+                {
+                    ++failures;
+                }
+            }
+        });
+    }
+
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+
+    cout << "threaded failures: " << failures << endl;
+
+    return failures == 0 ? 0 : -1;
+}
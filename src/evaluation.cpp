@@ -0,0 +1,109 @@
+// vim: tags+=~/Documents/DHI/PEGTL/taopeg.tags
+
+#include <algorithm>
+
+#include <evaluation.hpp>
+#include <calculator.hpp>
+
+namespace evaluation {
+
+namespace {
+
+// the source name is kept as a pointer to avoid allocations
+using expression_input = pegtl::memory_input<pegtl::tracking_mode::lazy, pegtl::eol::lf_crlf, const char*>;
+
+template<typename Rule>
+struct check_action : pegtl::nothing<Rule> {};
+
+// records on the stack how far the rules got before failing
+template<typename Rule>
+struct syntax_control : pegtl::normal<Rule>
+{
+    template<typename Input>
+    static void failure(const Input& in, calc_stack& s) noexcept
+    {
+        s.reach(static_cast<std::size_t>(in.current() - in.begin()));
+    }
+};
+
+template<template<typename> class Action>
+result run(std::string_view expression, calc_stack& s)
+{
+    expression_input in(expression.data(), expression.data() + expression.size(), "expression");
+    result res;
+
+    if ( !pegtl::parse<const_expr, Action, syntax_control>(in, s) )
+    {
+        res.error = status::syntax_error;
+        res.position = s.furthest();
+    }
+    else if ( !in.empty() )
+    {
+        // the expression is only partially understood
+        res.error = status::syntax_error;
+        res.position = std::max(s.furthest(), static_cast<std::size_t>(in.current() - in.begin()));
+    }
+
+    return res;
+}
+
+} // namespace
+
+const char* to_string(status s)
+{
+    switch ( s )
+    {
+        case status::ok:
+            return "ok";
+        case status::syntax_error:
+            return "syntax_error";
+        case status::unknown_identifier:
+            return "unknown_identifier";
+        case status::bad_operands:
+            return "bad_operands";
+        case status::division_by_zero:
+            return "division_by_zero";
+        case status::out_of_range:
+            return "out_of_range";
+    }
+
+    return "unknown";
+}
+
+result context::parse(std::string_view expression)
+{
+    stack_.clear();
+
+    return run<check_action>(expression, stack_);
+}
+
+result context::evaluate(std::string_view expression)
+{
+    stack_.clear();
+
+    result res = run<calc_action>(expression, stack_);
+
+    if ( !res )
+    {
+        return res;
+    }
+
+    if ( !stack_.ok() )
+    {
+        res.error = stack_.error();
+        res.position = stack_.position();
+    }
+    else if ( stack_.size() != 1 || calc_value::kind::opaque == stack_.top().type )
+    {
+        // literals the calculator cannot handle (strings, chars)
+        res.error = status::bad_operands;
+    }
+    else
+    {
+        res.val = stack_.top();
+    }
+
+    return res;
+}
+
+} // namespace evaluation
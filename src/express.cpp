@@ -2,18 +2,102 @@
 
 #include <iostream>
 #include <cstdlib>
+#include <string>
+#include <vector>
 
 #include <tao/pegtl/contrib/analyze.hpp>
 
 #include <grammar.hpp>
+#include <scope.hpp>
+#include <xref.hpp>
 
 using namespace std;
 
+struct xref_state
+{
+    xref::index index;
+    xref::id file = xref::none;
+    xref::id user = xref::none; // constant being declared
+    scope::path modules;
+    xref::id within = xref::none; // interned module path, none at the global scope
+    std::string module;           // module being opened
+};
+
+// Indexing actions
+template<typename Rule>
+struct index_action : nothing<Rule> {};
+
+template<>
+struct index_action<const_name>
+{
+    template<typename Input>
+    static void apply(const Input& in, xref_state& s)
+    {
+        s.user = s.index.intern(s.modules.qualify(in.string_view()));
+        s.index.declare(s.user, s.file, static_cast<std::uint32_t>(in.position().byte));
+    }
+};
+
+template<>
+struct index_action<scoped_name>
+{
+    template<typename Input>
+    static void apply(const Input& in, xref_state& s)
+    {
+        s.index.record(s.index.intern(in.string_view()), s.within, s.user, s.file,
+                       static_cast<std::uint32_t>(in.position().byte));
+    }
+};
+
+// names within other declarations are uses outside any constant
+template<>
+struct index_action<skipped_name>
+{
+    template<typename Input>
+    static void apply(const Input& in, xref_state& s)
+    {
+        s.index.record(s.index.intern(in.string_view()), s.within, xref::none, s.file,
+                       static_cast<std::uint32_t>(in.position().byte));
+    }
+};
+
+template<>
+struct index_action<module_name>
+{
+    template<typename Input>
+    static void apply(const Input& in, xref_state& s)
+    {
+        s.module = in.string();
+    }
+};
+
+template<>
+struct index_action<module_open>
+{
+    template<typename Input>
+    static void apply(const Input&, xref_state& s)
+    {
+        s.modules.open(s.module);
+        s.within = s.index.intern(s.modules.name());
+    }
+};
+
+template<>
+struct index_action<module_close>
+{
+    template<typename Input>
+    static void apply(const Input&, xref_state& s)
+    {
+        s.modules.close();
+        s.within = s.modules.name().empty() ? xref::none : s.index.intern(s.modules.name());
+    }
+};
+
 template<typename Rule>
 struct report_action
 {
     template<typename Input>
-    static void apply(const Input& in, int& /*id*/)
+    static void apply(const Input& in, xref_state& /*s*/)
     {
             using namespace std;
             cout << "Rule: " << typeid(Rule).name() << " " << in.string() << endl;
@@ -21,47 +105,139 @@ struct report_action
 };
 
 template<>
-struct report_action<scoped_or_literal>
+struct report_action<scoped_name>
 {
     template<typename Input>
-    static void apply(const Input& in, int& id)
+    static void apply(const Input& in, xref_state& s)
     {
             using namespace std;
-            ++id;
-            cout << "Rule: " << typeid(scoped_or_literal).name()
+            cout << "Rule: " << typeid(scoped_name).name()
                  << " " << in.string() << endl;
+            index_action<scoped_name>::apply(in, s);
     }
 };
 
+// sorted ';' separated names
+std::string join(const xref::index& index, std::vector<xref::id> ids)
+{
+    std::vector<std::string_view> names;
+    for (auto n : ids)
+    {
+        names.push_back(index.name(n));
+    }
+    sort(names.begin(), names.end());
+    names.erase(unique(names.begin(), names.end()), names.end());
+
+    std::string res;
+    for (auto n : names)
+    {
+        res += (res.empty() ? "" : ";") + std::string{n};
+    }
+    return res;
+}
+
+void report(const xref::index& index, const xref::occurrence& o)
+{
+    cout << index.file(o.file) << ":" << o.offset << " "
+         << (o.user == xref::none ? "" : index.name(o.user)) << " -> " << index.name(o.name) << endl;
+}
+
 int main (int argc, char *argv[])
 {
     using my_grammar = const_expr;
+    using my_idl = specification;
 
-    std::size_t issues = tao::pegtl::analyze< my_grammar >(-1);
+    std::size_t issues = tao::pegtl::analyze< my_grammar >(-1)
+                       + tao::pegtl::analyze< my_idl >(-1);
     if (issues > 0)
     {
-        return tao::pegtl::analyze< my_grammar >(1);
+        return tao::pegtl::analyze< my_grammar >(1) + tao::pegtl::analyze< my_idl >(1);
     }
 
     // expected inputs:
     // • expression to parse
     // • expected identifiers to parse
     // test passes if the expression is parsed properly and the number of identifiers matches
-    if ( argc <= 2 || argc > 3 )
+    // or a cross-reference query over idl files:
+    // • users <identifier> <expected constants> <idl files...>
+    // • uses <constant> <expected identifiers> <idl files...>
+    // • unused <expected constants> <idl files...>
+    // test passes if the files are indexed and the sorted ';' separated list matches
+    if ( argc <= 2 )
+        return -1;
+
+    const std::string mode = argv[1];
+    xref_state s;
+
+    if ( mode == "users" || mode == "uses" || mode == "unused" )
+    {
+        int first = mode == "unused" ? 3 : 4;
+        if ( argc <= first )
+            return -1;
+
+        for (int i = first; i < argc; ++i)
+        {
+            s.file = s.index.add_file(argv[i]);
+            s.user = xref::none;
+            s.modules = scope::path{};
+            s.within = xref::none;
+
+            pegtl::file_input in(argv[i]);
+            if( !pegtl::parse<my_idl, index_action>(in, s) )
+            {
+                cerr << "I don't understand " << argv[i] << endl;
+                return -1;
+            }
+        }
+
+        s.index.sort();
+        cout << "indexed " << s.index.size() << " identifiers" << endl;
+
+        std::vector<xref::id> found;
+
+        if ( mode == "unused" )
+        {
+            for (const auto& d : s.index.declarations())
+            {
+                if (!s.index.used(d.name))
+                {
+                    found.push_back(d.name);
+                }
+            }
+        }
+        else if (xref::id n = s.index.find(argv[2]); n != xref::none)
+        {
+            for (const auto& o : mode == "users" ? s.index.users(n) : s.index.uses(n))
+            {
+                report(s.index, o);
+                if (o.user != xref::none)
+                {
+                    found.push_back(mode == "users" ? o.user : o.name);
+                }
+            }
+        }
+
+        std::string res = join(s.index, found);
+        cout << "found: " << res << endl;
+        cout << "expected: " << argv[first - 1] << endl;
+
+        return res == argv[first - 1] ? 0 : -1;
+    }
+
+    if ( argc > 3 )
         return -1;
 
     int res = 0;
-    int identified = 0;
     int expected = atoi(argv[2]);
 
     pegtl::argv_input in( argv, 1);
 
-    if( pegtl::parse<my_grammar, report_action>(in, identified) && in.empty())
+    if( pegtl::parse<my_grammar, report_action>(in, s) && in.empty())
     {
         cout << "parsing success!" << endl;
 
-        // Check that literals are only parsed once
-        return identified - expected;
+        // Check that identifiers are only parsed once
+        return static_cast<int>(s.index.size()) - expected;
     }
     else {
         cerr << "I don't understand." << endl;